@@ -0,0 +1,115 @@
+/* INCLUDES FOR THIS PROJECT */
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "matching2D.hpp"
+#include "productClassifier.hpp"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+
+// Build the binary reference gallery used by the first pass of the classification cascade.
+// Every image in the input folder is one product, named after the image file.
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        cout << "Usage: " << argv[0] << " <reference_image_dir> [scale]" << endl;
+        return 1;
+    }
+    string imgPath = argv[1];
+
+    // resize reference images before detection
+    double scale = 1.0;
+    if (argc > 2)
+    {
+        size_t pos = 0;
+        try
+        {
+            scale = stod(argv[2], &pos);
+        }
+        catch (const logic_error &e)
+        { // invalid_argument or out_of_range
+            pos = 0;
+        }
+        if (pos == 0 || pos != string(argv[2]).size() || !(scale > 0.0))
+        {
+            cout << "ERROR: scale must be a positive number, got " << argv[2] << endl;
+            cout << "Usage: " << argv[0] << " <reference_image_dir> [scale]" << endl;
+            return 1;
+        }
+    }
+
+    // use the same detector, descriptor and output folders as the classifier
+    ClassifierConfig config;
+    string kptPath = config.cascadeKptPath;
+    string dscPath = config.cascadeDscPath;
+
+    try
+    {
+        fs::create_directories(kptPath);
+        fs::create_directories(dscPath);
+
+        vector<fs::path> imgFiles;
+        for (const auto &img : fs::directory_iterator(imgPath))
+        {
+            string ext = img.path().extension().string();
+            if (ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".bmp")
+            {
+                imgFiles.push_back(img.path());
+            }
+        }
+        sort(imgFiles.begin(), imgFiles.end());
+
+        for (const auto &imgFile : imgFiles)
+        {
+            string productName = imgFile.stem().string();
+
+            // load reference image and convert it to grayscale
+            cv::Mat refImg = cv::imread(imgFile.string());
+            if (refImg.empty())
+            {
+                cout << "WARNING: cannot read " << imgFile.string() << ", skipping" << endl;
+                continue;
+            }
+            cv::Mat refImgGray;
+            cv::cvtColor(refImg, refImgGray, cv::COLOR_BGR2GRAY);
+            if (scale != 1.0)
+            {
+                cv::resize(refImgGray, refImgGray, cv::Size(), scale, scale, cv::INTER_AREA);
+            }
+
+            // detect and describe keypoints with the cascade configuration
+            vector<cv::KeyPoint> refKeypoints;
+            cv::Mat refDescriptors;
+            if (!detKeypointsModern(refKeypoints, refImgGray, config.cascadeDetectorType, false))
+            {
+                cout << "ERROR: unknown cascade detector type " << config.cascadeDetectorType << endl;
+                return 1;
+            }
+            if (!descKeypoints(refKeypoints, refImgGray, refDescriptors, config.cascadeDescriptorType))
+            {
+                cout << "ERROR: unknown cascade descriptor type " << config.cascadeDescriptorType << endl;
+                return 1;
+            }
+
+            saveRefKeypoints(refKeypoints, kptPath + productName + ".txt");
+            saveRefDescriptors(refDescriptors, dscPath + productName + ".xml");
+            cout << productName << ": " << refKeypoints.size() << " keypoints" << endl;
+        }
+    }
+    catch (const exception &e)
+    {
+        cout << "ERROR building gallery: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -2,6 +2,7 @@
 #define dataStructures_h
 
 #include <vector>
+#include <string>
 #include <opencv2/core.hpp>
 
 
@@ -14,5 +15,13 @@ struct DataFrame { // represents the available sensor information at the same ti
     std::vector<cv::DMatch> kptMatches; // keypoint matches between previous and current frame
 };
 
+struct RefProduct { // represents a single product of the reference gallery
+
+    std::string name; // product name, taken from the reference file name
+
+    std::vector<cv::KeyPoint> keypoints; // 2D keypoints within reference image
+    cv::Mat descriptors; // keypoint descriptors
+};
+
 
 #endif /* dataStructures_h */
@@ -1,13 +1,35 @@
 #include <numeric>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <filesystem>
 #include "matching2D.hpp"
 
 using namespace std;
 
-// Find best matches for keypoints in two camera images based on several matching methods
-void matchDescriptors(vector<cv::KeyPoint> &kPtsSource, vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
+// Check whether detKeypointsModern() supports detectorType
+bool isModernDetectorType(string detectorType)
+{
+    vector<string> types = {"FAST", "SIFT", "BRISK", "ORB", "AKAZE"};
+    return find(types.begin(), types.end(), detectorType) != types.end();
+}
+
+// Check whether descKeypoints() supports descriptorType
+bool isDescriptorType(string descriptorType)
+{
+    vector<string> types = {"BRISK", "SIFT", "ORB", "AKAZE", "BRIEF", "FREAK"};
+    return find(types.begin(), types.end(), descriptorType) != types.end();
+}
+
+// Find best matches for keypoints in two camera images based on several matching methods,
+// returns false on an unknown matcher or selector type
+bool matchDescriptors(const vector<cv::KeyPoint> &kPtsSource, const vector<cv::KeyPoint> &kPtsRef, const cv::Mat &descSource, const cv::Mat &descRef,
                       vector<cv::DMatch> &matches, string descriptorType, string matcherType, string selectorType)
 {
     double t = (double)cv::getTickCount();
+    // local headers, a type conversion below reallocates them and leaves the caller's descriptors untouched
+    cv::Mat descSrc = descSource;
+    cv::Mat descRf = descRef;
     // configure matcher
     bool crossCheck = false;
     cv::Ptr<cv::DescriptorMatcher> matcher;
@@ -19,29 +41,28 @@ void matchDescriptors(vector<cv::KeyPoint> &kPtsSource, vector<cv::KeyPoint> &kP
     }
     else if (matcherType.compare("MAT_FLANN") == 0)
     {
-        if (descSource.type() != CV_32F)
+        if (descSrc.type() != CV_32F)
         { // OpenCV bug workaround : convert binary descriptors to 
           // floating point due to a bug in current OpenCV implementation
-            descSource.convertTo(descSource, CV_32F);
+            descSrc.convertTo(descSrc, CV_32F);
         }
-        if (descRef.type() != CV_32F)
+        if (descRf.type() != CV_32F)
         { // OpenCV bug workaround : convert binary descriptors to 
           // floating point due to a bug in current OpenCV implementation
-            descRef.convertTo(descRef, CV_32F);
+            descRf.convertTo(descRf, CV_32F);
         }
         matcher = cv::DescriptorMatcher::create(cv::DescriptorMatcher::FLANNBASED);
     } 
     else 
     {
-        cout << "ERROR in matcher-type within matchDescriptors() ....exitting" << std::endl;
-        exit(EXIT_FAILURE);
+        return false;
     }
 
     // perform matching task
     if (selectorType.compare("SEL_NN") == 0)
     { // nearest neighbor (best match)
 
-        matcher->match(descSource, descRef, matches); // Finds the best match for each descriptor in desc1
+        matcher->match(descSrc, descRf, matches); // Finds the best match for each descriptor in desc1
     }
     else if (selectorType.compare("SEL_KNN") == 0)
     { // k nearest neighbors (k=2)
@@ -49,12 +70,12 @@ void matchDescriptors(vector<cv::KeyPoint> &kPtsSource, vector<cv::KeyPoint> &kP
         double distRatio = 0.8;
 
         vector<vector<cv::DMatch>> knn_matches;
-        matcher->knnMatch(descSource, descRef, knn_matches, k);
+        matcher->knnMatch(descSrc, descRf, knn_matches, k);
 
         // distance ratio filtering
-        for (int i = 0; i < kPtsSource.size(); ++i) 
+        for (size_t i = 0; i < knn_matches.size(); ++i) 
         {
-            if (knn_matches[i][0].distance < distRatio * knn_matches[i][1].distance) 
+            if (knn_matches[i].size() == 2 && knn_matches[i][0].distance < distRatio * knn_matches[i][1].distance) 
             {
               matches.push_back(knn_matches[i][0]);
             }
@@ -62,15 +83,72 @@ void matchDescriptors(vector<cv::KeyPoint> &kPtsSource, vector<cv::KeyPoint> &kP
     }
     else 
     {
-        cout << "ERROR in selector-type within matchDescriptors() ....exitting" << std::endl;
-        exit(EXIT_FAILURE);
+        return false;
     }
     t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
     // cout << " Match descriptor in " << 1000 * t / 1.0 << " ms" << endl;
+    return true;
 }
 
-// Use one of several types of state-of-art descriptors to uniquely identify keypoints
-void descKeypoints(vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, string descriptorType)
+// Find best matches against a prebuilt FLANN index of the reference descriptors, equivalent to
+// matchDescriptors() with MAT_FLANN but without rebuilding the index on every call,
+// returns false on an unknown selector type
+bool matchDescriptorsIndexed(const cv::Mat &descSource, cv::flann::Index &indexRef, vector<cv::DMatch> &matches, string selectorType)
+{
+    // local header, a type conversion below reallocates it and leaves the caller's descriptors untouched
+    cv::Mat descSrc = descSource;
+    if (descSrc.type() != CV_32F)
+    { // the index is built on floating point descriptors
+        descSrc.convertTo(descSrc, CV_32F);
+    }
+
+    int k;
+    if (selectorType.compare("SEL_NN") == 0)
+    { // nearest neighbor (best match)
+        k = 1;
+    }
+    else if (selectorType.compare("SEL_KNN") == 0)
+    { // k nearest neighbors (k=2)
+        k = 2;
+    }
+    else
+    {
+        return false;
+    }
+    double distRatio = 0.8;
+
+    // knnSearch only reads the index, so one index can serve concurrent callers
+    cv::Mat indices, dists;
+    indexRef.knnSearch(descSrc, indices, dists, k, cv::flann::SearchParams());
+
+    for (int i = 0; i < indices.rows; ++i)
+    {
+        int idx0 = indices.at<int>(i, 0);
+        if (idx0 < 0)
+        {
+            continue;
+        }
+        // FLANN returns squared L2 distances
+        float dist0 = sqrt(dists.at<float>(i, 0));
+        if (k == 1)
+        {
+            matches.push_back(cv::DMatch(i, idx0, dist0));
+            continue;
+        }
+
+        // distance ratio filtering
+        int idx1 = indices.at<int>(i, 1);
+        if (idx1 >= 0 && dist0 < distRatio * sqrt(dists.at<float>(i, 1)))
+        {
+            matches.push_back(cv::DMatch(i, idx0, dist0));
+        }
+    }
+    return true;
+}
+
+// Use one of several types of state-of-art descriptors to uniquely identify keypoints,
+// returns false on an unknown descriptor type
+bool descKeypoints(vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, string descriptorType)
 {
     // select appropriate descriptor
     cv::Ptr<cv::DescriptorExtractor> extractor;
@@ -139,14 +217,14 @@ void descKeypoints(vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descr
     }
     else 
     {
-        std::cout << "ERROR in descriptor-type within descKeypoints() ....exitting" << std::endl;
-        exit(EXIT_FAILURE);
+        return false;
     }
     // perform feature description
     double t = (double)cv::getTickCount();
     extractor->compute(img, keypoints, descriptors);
     t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
     // cout << descriptorType << " descriptor extraction in " << 1000 * t / 1.0 << " ms" << endl;
+    return true;
 }
 
 // Detect keypoints in image using the traditional Shi-Thomasi detector
@@ -175,7 +253,7 @@ void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool b
         keypoints.push_back(newKeyPoint);
     }
     t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    cout << "Shi-Tomasi detection with n=" << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+    // cout << "Shi-Tomasi detection with n=" << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
 
     // visualize results
     if (bVis)
@@ -245,7 +323,7 @@ void detKeypointsHarris(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis
         }
     }
     t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    cout << "Harris detection with n=" << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+    // cout << "Harris detection with n=" << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
     // visualize results
     if (bVis)
     {
@@ -259,8 +337,9 @@ void detKeypointsHarris(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis
 }
 
 
-// Detect keypoints in image using moder keypoint detector
-void detKeypointsModern(vector<cv::KeyPoint> &keypoints, cv::Mat &img, string detectorType, bool bVis)
+// Detect keypoints in image using moder keypoint detector,
+// returns false on an unknown detector type
+bool detKeypointsModern(vector<cv::KeyPoint> &keypoints, cv::Mat &img, string detectorType, bool bVis)
 {
     // select appropriate detector
     cv::Ptr<cv::FeatureDetector> detector;
@@ -319,8 +398,7 @@ void detKeypointsModern(vector<cv::KeyPoint> &keypoints, cv::Mat &img, string de
     }
     else
     {
-        cout << "ERROR in detKeypointsModern() ....exitting" << endl;
-        exit(EXIT_FAILURE);
+        return false;
     }
     detector->detect(img, keypoints);
     t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
@@ -336,4 +414,95 @@ void detKeypointsModern(vector<cv::KeyPoint> &keypoints, cv::Mat &img, string de
         imshow(windowName, visImage);
         cv::waitKey(0);
     }
-}
\ No newline at end of file
+    return true;
+}
+
+
+// Import keypoints of a reference image from a txt file (x y size response octave angle per line)
+void loadRefKeypoints(vector<cv::KeyPoint> &keypoints, string kptFile)
+{
+    ifstream infile;
+    string temp;
+    infile.open(kptFile);
+    while (getline(infile, temp))
+    {
+        stringstream ss(temp);
+        istream_iterator<string> begin(ss);
+        istream_iterator<string> end;
+        vector<string> vstrings(begin, end);
+        if (vstrings.size() < 6)
+        {
+            continue;
+        }
+
+        cv::KeyPoint kpt;
+        kpt.pt = cv::Point2f(stof(vstrings[0]), stof(vstrings[1]));
+        kpt.size = stof(vstrings[2]);
+        kpt.response = stof(vstrings[3]);
+        kpt.octave = stoi(vstrings[4]);
+        kpt.angle = stof(vstrings[5]);
+
+        keypoints.push_back(kpt);
+    }
+    infile.close();
+}
+
+// Import descriptors of a reference image from an OpenCV xml file
+void loadRefDescriptors(cv::Mat &descriptors, string dscFile)
+{
+    cv::FileStorage file(dscFile, cv::FileStorage::READ);
+    file["descriptor"] >> descriptors;
+}
+
+// Export keypoints of a reference image to a txt file in the layout read by loadRefKeypoints()
+void saveRefKeypoints(const vector<cv::KeyPoint> &keypoints, string kptFile)
+{
+    ofstream outfile(kptFile);
+    for (const auto &kpt : keypoints)
+    {
+        outfile << kpt.pt.x << "\t" << kpt.pt.y << "\t" << kpt.size << "\t" << kpt.response << "\t"
+                << kpt.octave << "\t" << kpt.angle << "\t" << kpt.class_id << "\n";
+    }
+    outfile.close();
+}
+
+// Export descriptors of a reference image to an OpenCV xml file in the layout read by loadRefDescriptors()
+void saveRefDescriptors(const cv::Mat &descriptors, string dscFile)
+{
+    cv::FileStorage file(dscFile, cv::FileStorage::WRITE);
+    file << "descriptor" << descriptors;
+}
+
+// Load every product found in kptPath together with its descriptors from dscPath,
+// products without keypoints or descriptors are skipped and reported in warnings
+void loadRefProducts(vector<RefProduct> &products, string kptPath, string dscPath, vector<string> &warnings)
+{
+    if (!filesystem::exists(kptPath))
+    {
+        return;
+    }
+
+    vector<string> kptFiles;
+    for (const auto &kpt : filesystem::directory_iterator(kptPath))
+    {
+        if (kpt.path().extension() == ".txt")
+        {
+            kptFiles.push_back(kpt.path().string());
+        }
+    }
+    sort(kptFiles.begin(), kptFiles.end());
+
+    for (const auto &kptFile : kptFiles)
+    {
+        RefProduct product;
+        product.name = filesystem::path(kptFile).stem().string();
+        loadRefKeypoints(product.keypoints, kptFile);
+        loadRefDescriptors(product.descriptors, dscPath + product.name + ".xml");
+        if (product.keypoints.empty() || product.descriptors.empty())
+        {
+            warnings.push_back("skipping reference product " + product.name + " with no keypoints or descriptors");
+            continue;
+        }
+        products.push_back(product);
+    }
+}
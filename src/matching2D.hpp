@@ -13,17 +13,26 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/features2d.hpp>
+#include <opencv2/flann.hpp>
 #include <opencv2/xfeatures2d.hpp>
 #include <opencv2/xfeatures2d/nonfree.hpp>
 
 #include "dataStructures.h"
 
 
+bool isModernDetectorType(std::string detectorType);
+bool isDescriptorType(std::string descriptorType);
 void detKeypointsHarris(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false);
 void detKeypointsShiTomasi(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false);
-void detKeypointsModern(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std::string detectorType, bool bVis=false);
-void descKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, std::string descriptorType);
-void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
+bool detKeypointsModern(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std::string detectorType, bool bVis=false);
+bool descKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, std::string descriptorType);
+bool matchDescriptors(const std::vector<cv::KeyPoint> &kPtsSource, const std::vector<cv::KeyPoint> &kPtsRef, const cv::Mat &descSource, const cv::Mat &descRef,
                       std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType);
+bool matchDescriptorsIndexed(const cv::Mat &descSource, cv::flann::Index &indexRef, std::vector<cv::DMatch> &matches, std::string selectorType);
+void loadRefKeypoints(std::vector<cv::KeyPoint> &keypoints, std::string kptFile);
+void loadRefDescriptors(cv::Mat &descriptors, std::string dscFile);
+void saveRefKeypoints(const std::vector<cv::KeyPoint> &keypoints, std::string kptFile);
+void saveRefDescriptors(const cv::Mat &descriptors, std::string dscFile);
+void loadRefProducts(std::vector<RefProduct> &products, std::string kptPath, std::string dscPath, std::vector<std::string> &warnings);
 
 #endif /* matching2D_hpp */
@@ -0,0 +1,335 @@
+#include <algorithm>
+#include <exception>
+#include <utility>
+#include "matching2D.hpp"
+#include "productClassifier.hpp"
+
+using namespace std;
+
+
+// Score every reference product against the source descriptors as the ratio of matched reference keypoints,
+// the full gallery is searched through its prebuilt indexes when matcherType is MAT_FLANN
+ClassificationResult ProductModel::scoreProducts(vector<double> &scores, const vector<cv::KeyPoint> &srcKeypoints,
+                                                 const cv::Mat &srcDescriptors, bool bCascadeGallery) const
+{
+    const vector<RefProduct> &products = bCascadeGallery ? cascadeRefProducts : refProducts;
+    string descriptorType = bCascadeGallery ? "DES_BINARY" : modelConfig.matcherDescriptorType;
+    string matcherType = bCascadeGallery ? "MAT_BF" : modelConfig.matcherType;
+    string selectorType = bCascadeGallery ? "SEL_KNN" : modelConfig.selectorType;
+    bool bIndexed = !bCascadeGallery && !refIndexes.empty();
+
+    ClassificationResult result;
+    scores.assign(products.size(), 0.0);
+    for (size_t i = 0; i < products.size(); i++)
+    {
+        const RefProduct &ref = products[i];
+        if (srcDescriptors.empty() || ref.descriptors.empty())
+        {
+            continue; // nothing to match, score stays at zero
+        }
+
+        vector<cv::DMatch> matches;
+        bool bMatched;
+        if (bIndexed)
+        {
+            if (ref.descriptors.rows < (selectorType.compare("SEL_KNN") == 0 ? 2 : 1))
+            {
+                continue; // too few reference descriptors for the selector, score stays at zero
+            }
+            bMatched = matchDescriptorsIndexed(srcDescriptors, *refIndexes[i], matches, selectorType);
+        }
+        else
+        {
+            bMatched = matchDescriptors(srcKeypoints, ref.keypoints, srcDescriptors, ref.descriptors,
+                                        matches, descriptorType, matcherType, selectorType);
+        }
+        if (!bMatched)
+        {
+            result.status = ClassifyStatus::INVALID_CONFIG;
+            result.error = "unknown matcher type " + matcherType + " or selector type " + selectorType;
+            return result;
+        }
+        scores[i] = (double)matches.size() / ref.keypoints.size();
+    }
+    return result;
+}
+
+// Find the indices of the two best scores, -1 if there are fewer than two products
+static void topTwo(const vector<double> &scores, int &best, int &second)
+{
+    best = -1;
+    second = -1;
+    for (int i = 0; i < (int)scores.size(); i++)
+    {
+        if (best < 0 || scores[i] > scores[best])
+        {
+            second = best;
+            best = i;
+        }
+        else if (second < 0 || scores[i] > scores[second])
+        {
+            second = i;
+        }
+    }
+}
+
+
+shared_ptr<const ProductModel> ProductModel::load(const ClassifierConfig &config, string &error)
+{
+    if (config.matcherType != "MAT_BF" && config.matcherType != "MAT_FLANN")
+    {
+        error = "unknown matcher type " + config.matcherType;
+        return nullptr;
+    }
+    if (config.selectorType != "SEL_NN" && config.selectorType != "SEL_KNN")
+    {
+        error = "unknown selector type " + config.selectorType;
+        return nullptr;
+    }
+    if (config.matcherDescriptorType != "DES_BINARY" && config.matcherDescriptorType != "DES_HOG")
+    {
+        error = "unknown matcher descriptor type " + config.matcherDescriptorType;
+        return nullptr;
+    }
+    if (config.detectorType != "SHITOMASI" && config.detectorType != "HARRIS" && !isModernDetectorType(config.detectorType))
+    {
+        error = "unknown detector type " + config.detectorType;
+        return nullptr;
+    }
+    if (!isDescriptorType(config.descriptorType))
+    {
+        error = "unknown descriptor type " + config.descriptorType;
+        return nullptr;
+    }
+    if (config.bCascade && !isModernDetectorType(config.cascadeDetectorType))
+    { // the first pass only runs the detectors of detKeypointsModern()
+        error = "unknown cascade detector type " + config.cascadeDetectorType;
+        return nullptr;
+    }
+    if (config.bCascade && !isDescriptorType(config.cascadeDescriptorType))
+    {
+        error = "unknown cascade descriptor type " + config.cascadeDescriptorType;
+        return nullptr;
+    }
+
+    shared_ptr<ProductModel> model(new ProductModel());
+    model->modelConfig = config;
+
+    // the loaders throw on unreadable directories, malformed keypoint lines or malformed xml
+    try
+    {
+        loadRefProducts(model->refProducts, config.kptPath, config.dscPath, model->loadWarnings);
+        if (model->refProducts.empty())
+        {
+            error = "no reference products found in " + config.kptPath;
+            return nullptr;
+        }
+        if (config.matcherType == "MAT_FLANN")
+        { // build every index once here instead of on every match, same parameters as cv::FlannBasedMatcher
+            for (auto &ref : model->refProducts)
+            {
+                if (ref.descriptors.type() != CV_32F)
+                {
+                    ref.descriptors.convertTo(ref.descriptors, CV_32F);
+                }
+                model->refIndexes.push_back(cv::makePtr<cv::flann::Index>(ref.descriptors, cv::flann::KDTreeIndexParams()));
+            }
+        }
+
+        if (config.bCascade)
+        {
+            loadRefProducts(model->cascadeRefProducts, config.cascadeKptPath, config.cascadeDscPath, model->loadWarnings);
+        }
+    }
+    catch (const cv::Exception &e)
+    {
+        error = string("loading reference gallery failed: ") + e.what();
+        return nullptr;
+    }
+    catch (const exception &e)
+    {
+        error = string("loading reference gallery failed: ") + e.what();
+        return nullptr;
+    }
+    return model;
+}
+
+
+ClassifierContext::ClassifierContext(shared_ptr<const ProductModel> productModel) : model(std::move(productModel))
+{
+}
+
+ClassificationResult ClassifierContext::classify(const cv::Mat &frame)
+{
+    ClassificationResult result;
+    try
+    {
+        result = classifyFrame(frame);
+    }
+    catch (const cv::Exception &e)
+    {
+        result = ClassificationResult();
+        result.status = ClassifyStatus::OPENCV_ERROR;
+        result.error = e.what();
+    }
+
+    if (result.status == ClassifyStatus::OK)
+    {
+        cascadeStats.nFrames++;
+        if (result.bCascadeAccepted)
+        {
+            cascadeStats.nStage1++;
+        }
+        else
+        {
+            cascadeStats.nStage2++;
+        }
+
+        // in verify mode an accepted first pass is followed by the full pipeline
+        if (result.bCascadeAccepted && result.stage == 2)
+        {
+            cascadeStats.nVerified++;
+            if (result.cascadeProduct != result.product)
+            {
+                cascadeStats.nDisagreements++;
+            }
+        }
+    }
+    return result;
+}
+
+vector<ClassificationResult> ClassifierContext::classify(const vector<cv::Mat> &frames)
+{
+    vector<ClassificationResult> results;
+    results.reserve(frames.size());
+    for (const auto &frame : frames)
+    {
+        results.push_back(classify(frame));
+    }
+    return results;
+}
+
+ClassificationResult ClassifierContext::classifyFrame(const cv::Mat &frame)
+{
+    ClassificationResult result;
+    if (!model)
+    {
+        result.status = ClassifyStatus::INVALID_CONFIG;
+        result.error = "classifier context has no product model";
+        return result;
+    }
+    const ClassifierConfig &config = model->config();
+
+    if (frame.empty())
+    {
+        result.status = ClassifyStatus::EMPTY_FRAME;
+        result.error = "empty frame";
+        return result;
+    }
+
+    // convert source image to grayscale
+    cv::Mat srcImgGray;
+    if (frame.channels() == 3)
+    {
+        cv::cvtColor(frame, srcImgGray, cv::COLOR_BGR2GRAY);
+    }
+    else if (frame.channels() == 4)
+    {
+        cv::cvtColor(frame, srcImgGray, cv::COLOR_BGRA2GRAY);
+    }
+    else
+    {
+        srcImgGray = frame;
+    }
+
+    /*********************************************/
+    /* STAGE 1: CHEAP PASS AT REDUCED RESOLUTION */
+    /*********************************************/
+
+    vector<double> scores;
+    int best, second;
+    if (config.bCascade && !model->cascadeProducts().empty())
+    {
+        cv::Mat smallImgGray;
+        cv::resize(srcImgGray, smallImgGray, cv::Size(), config.cascadeScale, config.cascadeScale, cv::INTER_AREA);
+
+        vector<cv::KeyPoint> smallKeypoints;
+        cv::Mat smallDescriptors;
+        if (!detKeypointsModern(smallKeypoints, smallImgGray, config.cascadeDetectorType, false))
+        {
+            result.status = ClassifyStatus::INVALID_CONFIG;
+            result.error = "unknown cascade detector type " + config.cascadeDetectorType;
+            return result;
+        }
+        if (!descKeypoints(smallKeypoints, smallImgGray, smallDescriptors, config.cascadeDescriptorType))
+        {
+            result.status = ClassifyStatus::INVALID_CONFIG;
+            result.error = "unknown cascade descriptor type " + config.cascadeDescriptorType;
+            return result;
+        }
+
+        ClassificationResult status = model->scoreProducts(scores, smallKeypoints, smallDescriptors, true);
+        if (status.status != ClassifyStatus::OK)
+        {
+            return status;
+        }
+
+        // accept the first pass only if the winner is clear
+        topTwo(scores, best, second);
+        double secondScore = second < 0 ? 0.0 : scores[second];
+        result.bCascadeRan = true;
+        result.cascadeProduct = model->cascadeProducts()[best].name;
+        result.cascadeScore = scores[best];
+        result.cascadeMargin = scores[best] - secondScore;
+        result.bCascadeAccepted = result.cascadeScore >= config.cascadeMinScore && result.cascadeMargin >= config.cascadeMargin;
+        if (result.bCascadeAccepted && !config.bCascadeVerify)
+        {
+            result.product = result.cascadeProduct;
+            result.score = result.cascadeScore;
+            result.stage = 1;
+            return result;
+        }
+    }
+
+    /*************************************/
+    /* STAGE 2: FULL RESOLUTION FALLBACK */
+    /*************************************/
+
+    // extract 2D keypoints from the source image
+    vector<cv::KeyPoint> srcKeypoints;
+    if (config.detectorType.compare("SHITOMASI") == 0)
+    {
+        detKeypointsShiTomasi(srcKeypoints, srcImgGray, false);
+    }
+    else if (config.detectorType.compare("HARRIS") == 0)
+    {
+        detKeypointsHarris(srcKeypoints, srcImgGray, false);
+    }
+    else if (!detKeypointsModern(srcKeypoints, srcImgGray, config.detectorType, false))
+    {
+        result.status = ClassifyStatus::INVALID_CONFIG;
+        result.error = "unknown detector type " + config.detectorType;
+        return result;
+    }
+
+    // extract keypoint descriptors of the source image
+    cv::Mat srcDescriptors;
+    if (!descKeypoints(srcKeypoints, srcImgGray, srcDescriptors, config.descriptorType))
+    {
+        result.status = ClassifyStatus::INVALID_CONFIG;
+        result.error = "unknown descriptor type " + config.descriptorType;
+        return result;
+    }
+
+    ClassificationResult status = model->scoreProducts(scores, srcKeypoints, srcDescriptors, false);
+    if (status.status != ClassifyStatus::OK)
+    {
+        return status;
+    }
+
+    topTwo(scores, best, second);
+    result.score = scores[best];
+    result.product = scores[best] < config.minScore ? "None" : model->products()[best].name;
+    result.stage = 2;
+    return result;
+}
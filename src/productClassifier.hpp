@@ -0,0 +1,127 @@
+#ifndef productClassifier_hpp
+#define productClassifier_hpp
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+
+namespace cv { namespace flann { class Index; } }
+
+struct ClassifierConfig { // configuration of the reference gallery and of the classification pipeline
+
+    // detector and descriptor config
+    std::string detectorType = "SIFT";            // SHITOMASI, HARRIS, FAST, BRISK, ORB, AKAZE, SIFT
+    std::string descriptorType = "SIFT";          // BRIEF, ORB, FREAK, AKAZE, SIFT, BRISK
+    std::string kptPath = "../ref/keypoints/";
+    std::string dscPath = "../ref/descriptors/";
+
+    // matcher config
+    std::string matcherType = "MAT_FLANN";         // MAT_BF, MAT_FLANN
+    std::string matcherDescriptorType = "DES_HOG"; // DES_BINARY, DES_HOG
+    std::string selectorType = "SEL_KNN";          // SEL_NN, SEL_KNN
+    double minScore = 0.05;                        // min. score of the best product, below it the result is "None"
+
+    // cascade config: a cheap first pass with binary descriptors at reduced resolution,
+    // escalating to the full detector/descriptor above only when the first pass is ambiguous.
+    // The binary gallery is written by build_gallery with the same detector/descriptor types;
+    // cascadeMargin and cascadeMinScore are uncalibrated starting points, so the cascade is off by default
+    bool bCascade = false;
+    std::string cascadeDetectorType = "ORB";      // ORB, FAST
+    std::string cascadeDescriptorType = "ORB";    // ORB, BRIEF, BRISK, FREAK, AKAZE (binary only)
+    std::string cascadeKptPath = "../ref/keypoints_orb/";
+    std::string cascadeDscPath = "../ref/descriptors_orb/";
+    double cascadeScale = 0.5;                    // image scale used by the first pass
+    double cascadeMargin = 0.02;                  // min. score margin between the top two products to accept the first pass
+    double cascadeMinScore = 0.05;                // min. score of the top product to accept the first pass
+    bool bCascadeVerify = false;                  // also run the full pipeline on accepted first passes to calibrate the thresholds
+};
+
+enum class ClassifyStatus {
+    OK,
+    EMPTY_FRAME,      // the input frame has no pixels
+    INVALID_CONFIG,   // missing product model or unknown detector, descriptor, matcher or selector type
+    OPENCV_ERROR      // OpenCV raised an exception while processing the frame
+};
+
+struct ClassificationResult { // outcome of classifying a single frame
+
+    ClassifyStatus status = ClassifyStatus::OK;
+    std::string error;              // description of the failure, empty on success
+
+    std::string product = "None";   // name of the closest reference product
+    double score = -1.0;            // ratio of matched reference keypoints of the closest product
+    int stage = 0;                  // cascade stage that produced the result (1 = first pass, 2 = full pipeline)
+
+    // first pass of the cascade, filled whenever it ran, also when the frame escalated to the full pipeline
+    bool bCascadeRan = false;
+    bool bCascadeAccepted = false;  // first pass passed cascadeMinScore and cascadeMargin
+    std::string cascadeProduct = "None";
+    double cascadeScore = -1.0;
+    double cascadeMargin = -1.0;    // score margin between the two best products of the first pass
+};
+
+struct CascadeStats { // number of frames resolved by each stage of the cascade
+
+    int nFrames = 0;
+    int nStage1 = 0;
+    int nStage2 = 0;
+
+    // with bCascadeVerify, accepted first passes compared against the full pipeline
+    int nVerified = 0;
+    int nDisagreements = 0;
+};
+
+
+// Immutable reference gallery and its matching indexes, safe to share between any number of classifier contexts and threads
+class ProductModel
+{
+public:
+    // Load the gallery described by config, returns nullptr and fills error on failure
+    static std::shared_ptr<const ProductModel> load(const ClassifierConfig &config, std::string &error);
+
+    const ClassifierConfig &config() const { return modelConfig; }
+    const std::vector<RefProduct> &products() const { return refProducts; }
+    const std::vector<RefProduct> &cascadeProducts() const { return cascadeRefProducts; }
+    const std::vector<std::string> &warnings() const { return loadWarnings; } // non-fatal problems found while loading
+
+private:
+    friend class ClassifierContext;
+
+    ProductModel() = default;
+
+    // Score every product of the full or the cascade gallery against the source descriptors
+    ClassificationResult scoreProducts(std::vector<double> &scores, const std::vector<cv::KeyPoint> &srcKeypoints,
+                                       const cv::Mat &srcDescriptors, bool bCascadeGallery) const;
+
+    ClassifierConfig modelConfig;
+    std::vector<RefProduct> refProducts;        // gallery of the full pipeline
+    std::vector<cv::Ptr<cv::flann::Index>> refIndexes; // one FLANN index per entry of refProducts, empty unless matcherType is MAT_FLANN
+    std::vector<RefProduct> cascadeRefProducts; // binary gallery of the first pass, empty if the cascade is disabled
+    std::vector<std::string> loadWarnings;      // e.g. reference products skipped for missing keypoints or descriptors
+};
+
+
+// Per-caller classification state, cheap to create; use one context per thread,
+// classify() runs on the calling thread so throughput scales with the number of callers
+class ClassifierContext
+{
+public:
+    explicit ClassifierContext(std::shared_ptr<const ProductModel> productModel);
+
+    ClassificationResult classify(const cv::Mat &frame);
+    std::vector<ClassificationResult> classify(const std::vector<cv::Mat> &frames);
+
+    const CascadeStats &stats() const { return cascadeStats; }
+
+private:
+    ClassificationResult classifyFrame(const cv::Mat &frame);
+
+    std::shared_ptr<const ProductModel> model;
+    CascadeStats cascadeStats;
+};
+
+#endif /* productClassifier_hpp */